@@ -0,0 +1,140 @@
+/*  @file   frame_stats.c
+ *  @brief  Function definitions for front end frame timing
+ *  @author Ryan V. Ngo
+ */
+
+#include "frame_stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <SDL2/SDL_timer.h>
+
+/******************** Internal ********************/
+
+/*  Samples are stored in microseconds in a ring buffer per phase.
+ *  Phases recorded more than once per frame are summed into the
+ *  current frame's slot.
+ */
+typedef struct frame_stats {
+  double samples[PHASE_COUNT][FRAME_STATS_WINDOW];
+  uint32_t instructions[FRAME_STATS_WINDOW];
+  uint32_t head;
+  uint32_t count;
+  uint64_t total_frames;
+  uint64_t total_instructions;
+  double total_time;
+  double worst[PHASE_COUNT];
+  double ticks_to_us;
+} frame_stats;
+
+static const char* phase_names[PHASE_COUNT] = {
+  [PHASE_EVENTS]      = "events",
+  [PHASE_EMULATE]     = "emulate",
+  [PHASE_RUN_AHEAD]   = "run_ahead",
+  [PHASE_READ_SCREEN] = "read_screen",
+  [PHASE_RENDER]      = "render",
+  [PHASE_FRAME]       = "frame",
+};
+
+int _compare_double(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/******************** Timing ********************/
+
+uint64_t frame_stats_now() {
+  return SDL_GetPerformanceCounter();
+}
+
+void frame_stats_record(frame_stats* stats, frame_phase phase, uint64_t start, uint64_t end) {
+  stats->samples[phase][stats->head] += (end - start) * stats->ticks_to_us;
+}
+
+void frame_stats_add_instructions(frame_stats* stats, uint32_t count) {
+  stats->instructions[stats->head] += count;
+}
+
+void frame_stats_end_frame(frame_stats* stats) {
+  for (int phase = 0; phase < PHASE_COUNT; phase++) {
+    double sample = stats->samples[phase][stats->head];
+    if (sample > stats->worst[phase]) stats->worst[phase] = sample;
+  }
+  stats->total_frames++;
+  stats->total_instructions += stats->instructions[stats->head];
+  stats->total_time += stats->samples[PHASE_FRAME][stats->head];
+
+  stats->head = (stats->head + 1) % FRAME_STATS_WINDOW;
+  if (stats->count < FRAME_STATS_WINDOW) stats->count++;
+
+  for (int phase = 0; phase < PHASE_COUNT; phase++) {
+    stats->samples[phase][stats->head] = 0;
+  }
+  stats->instructions[stats->head] = 0;
+}
+
+/******************** Reporting ********************/
+
+/* Percentile p (0 to 100) of the completed frames in the window, in microseconds */
+double frame_stats_percentile(frame_stats* stats, frame_phase phase, double p) {
+  if (stats->count == 0) return 0;
+
+  double sorted[FRAME_STATS_WINDOW];
+  for (uint32_t i = 0; i < stats->count; i++) {
+    uint32_t idx = (stats->head + FRAME_STATS_WINDOW - 1 - i) % FRAME_STATS_WINDOW;
+    sorted[i] = stats->samples[phase][idx];
+  }
+  qsort(sorted, stats->count, sizeof(double), _compare_double);
+
+  uint32_t rank = (uint32_t)(p / 100.0 * (stats->count - 1) + 0.5);
+  return sorted[rank];
+}
+
+double frame_stats_max(frame_stats* stats, frame_phase phase) {
+  return frame_stats_percentile(stats, phase, 100.0);
+}
+
+/* Emulated instructions per second over the completed frames in the window */
+double frame_stats_ips(frame_stats* stats) {
+  uint64_t instructions = 0;
+  double time = 0;
+  for (uint32_t i = 0; i < stats->count; i++) {
+    uint32_t idx = (stats->head + FRAME_STATS_WINDOW - 1 - i) % FRAME_STATS_WINDOW;
+    instructions += stats->instructions[idx];
+    time += stats->samples[PHASE_FRAME][idx];
+  }
+  if (time <= 0) return 0;
+  return instructions / (time / 1e6);
+}
+
+void frame_stats_print(frame_stats* stats, FILE* out) {
+  fprintf(out, "Frame timing (last %u of %llu frames, microseconds):\n",
+      stats->count, (unsigned long long)stats->total_frames);
+  fprintf(out, "  %-12s %10s %10s %10s %10s\n", "phase", "p50", "p99", "max", "worst");
+  for (int phase = 0; phase < PHASE_COUNT; phase++) {
+    fprintf(out, "  %-12s %10.1f %10.1f %10.1f %10.1f\n",
+        phase_names[phase],
+        frame_stats_percentile(stats, phase, 50.0),
+        frame_stats_percentile(stats, phase, 99.0),
+        frame_stats_max(stats, phase),
+        stats->worst[phase]);
+  }
+  double ips = stats->total_time > 0 ? stats->total_instructions / (stats->total_time / 1e6) : 0;
+  fprintf(out, "  %llu instructions, %.0f instructions/sec overall\n",
+      (unsigned long long)stats->total_instructions, ips);
+}
+
+/******************** Create/Destroy ********************/
+
+frame_stats* frame_stats_new() {
+  frame_stats* stats = calloc(1, sizeof(frame_stats));
+  stats->ticks_to_us = 1e6 / SDL_GetPerformanceFrequency();
+  return stats;
+}
+
+void frame_stats_free(frame_stats* stats) {
+  free(stats);
+}
@@ -0,0 +1,45 @@
+/*  @file   frame_stats.h
+ *  @brief  Function prototypes and defines for front end frame timing
+ *  @author Ryan V. Ngo
+ */
+
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define FRAME_STATS_WINDOW  256
+
+typedef enum {
+  PHASE_EVENTS,
+  PHASE_EMULATE,
+  PHASE_RUN_AHEAD,
+  PHASE_READ_SCREEN,
+  PHASE_RENDER,
+  PHASE_FRAME,
+  PHASE_COUNT
+} frame_phase;
+
+typedef struct frame_stats frame_stats;
+
+/******************** Timing ********************/
+
+uint64_t frame_stats_now();
+void frame_stats_record(frame_stats* stats, frame_phase phase, uint64_t start, uint64_t end);
+void frame_stats_add_instructions(frame_stats* stats, uint32_t count);
+void frame_stats_end_frame(frame_stats* stats);
+
+/******************** Reporting ********************/
+
+double frame_stats_percentile(frame_stats* stats, frame_phase phase, double p);
+double frame_stats_max(frame_stats* stats, frame_phase phase);
+double frame_stats_ips(frame_stats* stats);
+void frame_stats_print(frame_stats* stats, FILE* out);
+
+/******************** Create/Destroy ********************/
+
+frame_stats* frame_stats_new();
+void frame_stats_free(frame_stats* stats);
+
+#endif
@@ -15,18 +15,55 @@
 #include <SDL2/SDL_keyboard.h>
 
 #include "rem8C.h"
+#include "frame_stats.h"
+#include "mosaic.h"
 
-SDL_Window* create_window();
+#define OVERLAY_REFRESH   30
+
+#define RUN_AHEAD_MAX         8
+#define RUN_AHEAD_CYCLES      (17 / 2)
+#define RUN_AHEAD_BUDGET_US   8000
+#define RUN_AHEAD_STRIKES     30
+
+#define MOSAIC_WINDOW_WIDTH   1280
+
+/*  State shared by the single instance and mosaic loops. */
+typedef struct {
+  rem8C_pool* pool;
+  frame_stats* stats;
+  int running;
+  int pause;
+  int overlay;
+  uint32_t overlay_ips;
+  uint32_t overlay_frame_us;
+  uint32_t frames_since_refresh;
+  Uint32 last_time;
+  uint64_t frame_start;
+  uint64_t events_start;
+  uint64_t events_end;
+} front_end;
+
+SDL_Window* create_window(int width, int height);
 void render_screen(SDL_Renderer* renderer, unsigned char data[SCREEN_WIDTH][SCREEN_HEIGHT]);
+void render_overlay(SDL_Renderer* renderer, uint32_t ips, uint32_t frame_us);
+void front_end_init(front_end* fe, rem8C_pool* pool, int overlay);
+void front_end_poll(front_end* fe);
+uint32_t front_end_begin_frame(front_end* fe);
+void front_end_end_frame(front_end* fe, uint64_t frame_end);
+int run_single(front_end* fe, int run_ahead);
+int run_mosaic(front_end* fe);
 
 int main(int argc, char* argv[]) {
   /* argument parsing */
   char* rom_file = NULL;
   unsigned short load_addr = START_ADDR;
   unsigned short start_addr = START_ADDR;
+  int overlay = 0;
+  int run_ahead = 0;
+  int instances = 1;
 
   int opt;
-  while ((opt = getopt(argc, argv, "r:l:s:")) != -1) {
+  while ((opt = getopt(argc, argv, "r:l:s:pa:n:")) != -1) {
     switch (opt) {
       case 'r':
         rom_file = optarg;
@@ -37,6 +74,20 @@ int main(int argc, char* argv[]) {
       case 's':
         start_addr = strtoul(optarg, NULL, 16);
         break;
+      case 'p':
+        overlay = 1;
+        break;
+      case 'a':
+        run_ahead = strtol(optarg, NULL, 10);
+        if (run_ahead < 0) {
+          printf("! Run-ahead frames must be 0 or more !\n");
+          return 1;
+        }
+        if (run_ahead > RUN_AHEAD_MAX) run_ahead = RUN_AHEAD_MAX;
+        break;
+      case 'n':
+        instances = strtoul(optarg, NULL, 10);
+        break;
       default: break;
     }
   }
@@ -46,6 +97,16 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
+  if (instances < 1 || instances > MOSAIC_MAX_TILES) {
+    printf("! Instance count must be 1 to %d !\n", MOSAIC_MAX_TILES);
+    return 1;
+  }
+
+  if (instances > 1 && run_ahead) {
+    printf("! Run-ahead is not supported with multiple instances !\n");
+    return 1;
+  }
+
   FILE* rom = fopen(rom_file, "rb");
   if (!rom) {
     printf("ROM not found \n");
@@ -73,65 +134,239 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  /* preparing emulator */
-  rem8C* cpu = rem8C_new();
-  rem8C_set_start_addr(cpu, start_addr);
-  rem8C_memset(cpu, load_addr, prog, size);
+  /* preparing emulators */
+  rem8C_pool* pool = rem8C_pool_new(instances, load_addr, start_addr, prog, size);
   free(prog);
+  if (!pool) {
+    printf("! Failed to create emulator pool !\n");
+    return 1;
+  }
+
+  /* running emulators */
+  front_end fe;
+  front_end_init(&fe, pool, overlay);
+  int status = (instances > 1) ? run_mosaic(&fe) : run_single(&fe, run_ahead);
+
+  rem8C_pool_free(pool);
+  frame_stats_print(fe.stats, stdout);
+  frame_stats_free(fe.stats);
+  return status;
+}
+
+void front_end_init(front_end* fe, rem8C_pool* pool, int overlay) {
+  fe->pool = pool;
+  fe->stats = frame_stats_new();
+  fe->running = 1;
+  fe->pause = 0;
+  fe->overlay = overlay;
+  fe->overlay_ips = 0;
+  fe->overlay_frame_us = 0;
+  fe->frames_since_refresh = 0;
+  fe->last_time = 0;
+  fe->frame_start = frame_stats_now();
+  fe->events_start = fe->frame_start;
+  fe->events_end = fe->frame_start;
+}
+
+/* Handle pending events, keypad input goes to every instance */
+void front_end_poll(front_end* fe) {
+  fe->events_start = frame_stats_now();
+  SDL_Event event;
+  while (SDL_PollEvent(&event)) {
+    if (event.type == SDL_QUIT) fe->running = 0;
+    if (event.type != SDL_KEYDOWN && event.type != SDL_KEYUP) continue;
+
+    SDL_Keycode key = event.key.keysym.sym;
+    for (size_t n = 0; n < rem8C_pool_count(fe->pool); n++) {
+      rem8C* cpu = rem8C_pool_get(fe->pool, n);
+      if (event.type == SDL_KEYDOWN) rem8C_set_key(cpu, key);
+      else rem8C_unset_key(cpu, key);
+    }
+
+    if (event.type != SDL_KEYDOWN) continue;
+    if (key == SDLK_ESCAPE) fe->running = 0;
+    if (key == 'm') fe->pause ^= 1;
+    if (key == 'o') fe->overlay ^= 1;
+    if (key == 'b') rem8C_pool_reset(fe->pool);
+  }
+  fe->events_end = frame_stats_now();
+}
+
+/*  Returns the number of cycles to run if a frame is due, otherwise 0.
+ *  Only the poll of the frame's own iteration is recorded, not the idle
+ *  polling between frames.
+ */
+uint32_t front_end_begin_frame(front_end* fe) {
+  if (fe->pause) {
+    fe->frame_start = frame_stats_now();
+    return 0;
+  }
+
+  Uint32 curr_time = SDL_GetTicks();
+  Uint32 elapsed_time = curr_time - fe->last_time;
+  if (elapsed_time < 17) return 0;
+
+  fe->last_time = curr_time;
+  frame_stats_record(fe->stats, PHASE_EVENTS, fe->events_start, fe->events_end);
+  return elapsed_time / 2;
+}
+
+void front_end_end_frame(front_end* fe, uint64_t frame_end) {
+  frame_stats_record(fe->stats, PHASE_FRAME, fe->frame_start, frame_end);
+  frame_stats_end_frame(fe->stats);
+  fe->frame_start = frame_end;
+
+  /* sorting the window is cheap, but not every frame */
+  if (fe->overlay && ++fe->frames_since_refresh >= OVERLAY_REFRESH) {
+    fe->overlay_ips = frame_stats_ips(fe->stats);
+    fe->overlay_frame_us = frame_stats_percentile(fe->stats, PHASE_FRAME, 99.0);
+    fe->frames_since_refresh = 0;
+  }
+}
+
+/* Run the first instance of the pool in its own window */
+int run_single(front_end* fe, int run_ahead) {
+  rem8C* cpu = rem8C_pool_get(fe->pool, 0);
+  rem8C* snapshot = run_ahead ? rem8C_new() : NULL;
+  int run_ahead_strikes = 0;
 
   uint8_t screen_buff[SCREEN_WIDTH][SCREEN_HEIGHT] = {0};
 
-  SDL_Window* window = create_window();
+  SDL_Window* window = create_window(640, 320);
   SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
 
-  /* running emulator */
-  int running = 1;
-  int pause = 0;
-  Uint32 last_time = 0;
-  while (running) {
-    /* input logic */
-    SDL_Event event;
-    while (SDL_PollEvent(&event)) {
-      if (event.type == SDL_QUIT) running = 0;
-      if (event.type == SDL_KEYDOWN) {
-        if (event.key.keysym.sym == SDLK_ESCAPE) running = 0;
+  while (fe->running) {
+    front_end_poll(fe);
+    uint32_t cycles = front_end_begin_frame(fe);
+    if (!cycles) continue;
+
+    uint64_t emulate_start = frame_stats_now();
+    rem8C_update_timers(cpu);
+    for (uint32_t i = 0; i < cycles; i++) {
+      rem8C_cycle(cpu);
+    }
+    frame_stats_add_instructions(fe->stats, cycles);
+
+    /* run ahead one 60Hz frame of cycles at a time, display that frame, then rewind */
+    uint64_t run_ahead_start = frame_stats_now();
+    if (run_ahead) {
+      rem8C_copy(snapshot, cpu);
+      for (int frame = 0; frame < run_ahead; frame++) {
+        rem8C_update_timers(cpu);
+        for (uint32_t i = 0; i < RUN_AHEAD_CYCLES; i++) {
+          rem8C_cycle(cpu);
+        }
+      }
+    }
+
+    uint64_t read_start = frame_stats_now();
+    rem8C_read_screen(cpu, 0, 0, screen_buff, sizeof(screen_buff));
+    uint64_t read_end = frame_stats_now();
+
+    if (run_ahead) {
+      rem8C_copy(cpu, snapshot);
+      uint64_t restore_end = frame_stats_now();
+
+      /* fall back a frame at a time if the host can't keep up */
+      uint64_t run_ahead_ticks = (read_start - run_ahead_start) + (restore_end - read_end);
+      double run_ahead_us = run_ahead_ticks * 1e6 / SDL_GetPerformanceFrequency();
+      if (run_ahead_us > RUN_AHEAD_BUDGET_US) run_ahead_strikes++;
+      else run_ahead_strikes = 0;
+      if (run_ahead_strikes >= RUN_AHEAD_STRIKES) {
+        run_ahead--;
+        run_ahead_strikes = 0;
+        printf("! Run-ahead over budget, reducing to %d frames !\n", run_ahead);
       }
-      if (event.type == SDL_KEYDOWN) rem8C_set_key(cpu, event.key.keysym.sym);
-      if (event.type == SDL_KEYUP) rem8C_unset_key(cpu, event.key.keysym.sym);
-      if (event.key.keysym.sym == 'm') pause ^= 1;
     }
-    
-    /* pausing */
-    if (pause) continue;
-
-    /* timing and display logic */
-    Uint32 curr_time = SDL_GetTicks();
-    Uint32 elapsed_time = curr_time - last_time;
-    if (elapsed_time >= 17) {
+
+    uint64_t render_start = frame_stats_now();
+    render_screen(renderer, screen_buff);
+    if (fe->overlay) render_overlay(renderer, fe->overlay_ips, fe->overlay_frame_us);
+    SDL_RenderPresent(renderer);
+    uint64_t render_end = frame_stats_now();
+
+    frame_stats_record(fe->stats, PHASE_EMULATE, emulate_start, run_ahead_start);
+    frame_stats_record(fe->stats, PHASE_RUN_AHEAD, run_ahead_start, read_start);
+    frame_stats_record(fe->stats, PHASE_READ_SCREEN, read_start, read_end);
+    frame_stats_record(fe->stats, PHASE_RUN_AHEAD, read_end, render_start);
+    frame_stats_record(fe->stats, PHASE_RENDER, render_start, render_end);
+    front_end_end_frame(fe, render_end);
+  }
+
+  SDL_DestroyWindow(window);
+  SDL_DestroyRenderer(renderer);
+  if (snapshot) rem8C_free(snapshot);
+  return 0;
+}
+
+/*  Run every instance of the pool side by side in one window.
+ *  Each instance's screen is a tile of a single atlas texture.
+ */
+int run_mosaic(front_end* fe) {
+  int instances = rem8C_pool_count(fe->pool);
+  uint8_t screen_buff[SCREEN_WIDTH][SCREEN_HEIGHT] = {0};
+
+  SDL_Window* window = create_window(640, 320);
+  SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+  mosaic* view = mosaic_new(renderer, instances);
+  if (!view) {
+    printf("! Failed to create mosaic texture !\n");
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    return 1;
+  }
+
+  int scale = MOSAIC_WINDOW_WIDTH / (mosaic_columns(view) * SCREEN_WIDTH);
+  if (scale < 1) scale = 1;
+  SDL_SetWindowSize(window,
+      mosaic_columns(view) * SCREEN_WIDTH * scale,
+      mosaic_rows(view) * SCREEN_HEIGHT * scale);
+
+  while (fe->running) {
+    front_end_poll(fe);
+    uint32_t cycles = front_end_begin_frame(fe);
+    if (!cycles) continue;
+
+    uint64_t read_time = 0;
+    uint64_t emulate_start = frame_stats_now();
+    for (int n = 0; n < instances; n++) {
+      rem8C* cpu = rem8C_pool_get(fe->pool, n);
       rem8C_update_timers(cpu);
-      for (uint32_t i = 0; i < (elapsed_time / 2); i++) {
+      for (uint32_t i = 0; i < cycles; i++) {
         rem8C_cycle(cpu);
       }
+      uint64_t read_start = frame_stats_now();
       rem8C_read_screen(cpu, 0, 0, screen_buff, sizeof(screen_buff));
-      render_screen(renderer, screen_buff);
-      last_time = curr_time;
+      mosaic_update_tile(view, n, screen_buff);
+      read_time += frame_stats_now() - read_start;
     }
+    frame_stats_add_instructions(fe->stats, cycles * instances);
+
+    uint64_t render_start = frame_stats_now();
+    mosaic_present(view);
+    if (fe->overlay) render_overlay(renderer, fe->overlay_ips, fe->overlay_frame_us);
+    SDL_RenderPresent(renderer);
+    uint64_t render_end = frame_stats_now();
 
+    frame_stats_record(fe->stats, PHASE_EMULATE, emulate_start, render_start - read_time);
+    frame_stats_record(fe->stats, PHASE_READ_SCREEN, 0, read_time);
+    frame_stats_record(fe->stats, PHASE_RENDER, render_start, render_end);
+    front_end_end_frame(fe, render_end);
   }
 
+  mosaic_free(view);
   SDL_DestroyWindow(window);
   SDL_DestroyRenderer(renderer);
-  rem8C_free(cpu);
   return 0;
 }
 
-SDL_Window* create_window() {
+SDL_Window* create_window(int width, int height) {
   return SDL_CreateWindow(
       "CHIP-8 Emulator",
       SDL_WINDOWPOS_UNDEFINED,
       SDL_WINDOWPOS_UNDEFINED,
-      640,
-      320,
+      width,
+      height,
       SDL_WINDOW_SHOWN
   );
 }
@@ -147,6 +382,43 @@ void render_screen(SDL_Renderer* renderer, uint8_t data[SCREEN_WIDTH][SCREEN_HEI
       SDL_RenderFillRect(renderer, &rect);
     }
   }
-  SDL_RenderPresent(renderer);
+}
+
+/*  Draw a number in a 3x5 digit font at (X, Y) with the given pixel scale.
+ *  Returns the X position following the last digit.
+ */
+int render_number(SDL_Renderer* renderer, uint32_t num, int X, int Y, int scale) {
+  static const uint8_t digits[10][5] = {
+    {7, 5, 5, 5, 7}, {2, 6, 2, 2, 7}, {7, 1, 7, 4, 7}, {7, 1, 7, 1, 7}, {5, 5, 7, 1, 1},
+    {7, 4, 7, 1, 7}, {7, 4, 7, 5, 7}, {7, 1, 2, 4, 4}, {7, 5, 7, 5, 7}, {7, 5, 7, 1, 7},
+  };
+
+  char text[11];
+  int len = snprintf(text, sizeof(text), "%u", num);
+  for (int i = 0; i < len; i++) {
+    const uint8_t* glyph = digits[text[i] - '0'];
+    for (int y = 0; y < 5; y++) {
+      for (int x = 0; x < 3; x++) {
+        if (!((glyph[y] >> (2 - x)) & 0x01)) continue;
+        SDL_Rect rect = {X + x * scale, Y + y * scale, scale, scale};
+        SDL_RenderFillRect(renderer, &rect);
+      }
+    }
+    X += 4 * scale;
+  }
+  return X;
+}
+
+/*  Draw emulated instructions/sec (top row) and
+ *  p99 host frame time in microseconds (bottom row).
+ */
+void render_overlay(SDL_Renderer* renderer, uint32_t ips, uint32_t frame_us) {
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+  SDL_Rect background = {0, 0, 170, 34};
+  SDL_RenderFillRect(renderer, &background);
+
+  SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+  render_number(renderer, ips, 4, 4, 2);
+  render_number(renderer, frame_us, 4, 20, 2);
 }
 
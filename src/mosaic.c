@@ -0,0 +1,122 @@
+/*  @file   mosaic.c
+ *  @brief  Function definitions for multi-instance mosaic viewer
+ *  @author Ryan V. Ngo
+ */
+
+#include "mosaic.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+/******************** Mosaic & Internal ********************/
+
+/*  Every instance's screen is a tile in one atlas texture.
+ *  Only tiles whose screen changed since the last frame are uploaded,
+ *  and the whole atlas is presented with a single copy.
+ */
+typedef struct mosaic {
+  SDL_Renderer* renderer;
+  SDL_Texture* atlas;
+  int tiles;
+  int columns;
+  int rows;
+  uint8_t (*last)[SCREEN_WIDTH][SCREEN_HEIGHT];
+} mosaic;
+
+#define PIXEL_ON      0xFFFCCC2E
+#define PIXEL_OFF     0xFF966817
+
+/******************** Mosaic Operations ********************/
+
+void mosaic_update_tile(mosaic* view, int tile, uint8_t data[SCREEN_WIDTH][SCREEN_HEIGHT]) {
+  if (tile < 0 || tile >= view->tiles) return;
+  if (memcmp(view->last[tile], data, sizeof(view->last[tile])) == 0) return;
+  memcpy(view->last[tile], data, sizeof(view->last[tile]));
+
+  uint32_t pixels[SCREEN_HEIGHT][SCREEN_WIDTH];
+  for (int y = 0; y < SCREEN_HEIGHT; y++) {
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+      pixels[y][x] = data[x][y] ? PIXEL_ON : PIXEL_OFF;
+    }
+  }
+
+  SDL_Rect rect = {
+    (tile % view->columns) * SCREEN_WIDTH,
+    (tile / view->columns) * SCREEN_HEIGHT,
+    SCREEN_WIDTH,
+    SCREEN_HEIGHT
+  };
+  SDL_UpdateTexture(view->atlas, &rect, pixels, sizeof(pixels[0]));
+}
+
+void mosaic_present(mosaic* view) {
+  SDL_RenderCopy(view->renderer, view->atlas, NULL, NULL);
+}
+
+/******************** Mosaic Configuration ********************/
+
+int mosaic_columns(mosaic* view) {
+  return view->columns;
+}
+
+int mosaic_rows(mosaic* view) {
+  return view->rows;
+}
+
+/******************** Mosaic Create/Destroy ********************/
+
+mosaic* mosaic_new(SDL_Renderer* renderer, int tiles) {
+  if (tiles < 1 || tiles > MOSAIC_MAX_TILES) return NULL;
+
+  mosaic* view = malloc(sizeof(mosaic));
+  if (!view) return NULL;
+  view->renderer = renderer;
+  view->tiles = tiles;
+  view->columns = 1;
+  while (view->columns * view->columns < tiles) view->columns++;
+  view->rows = (tiles + view->columns - 1) / view->columns;
+
+  view->atlas = SDL_CreateTexture(
+      renderer,
+      SDL_PIXELFORMAT_ARGB8888,
+      SDL_TEXTUREACCESS_STREAMING,
+      view->columns * SCREEN_WIDTH,
+      view->rows * SCREEN_HEIGHT
+  );
+  if (!view->atlas) {
+    free(view);
+    return NULL;
+  }
+
+  /* no valid screen is all 0xFF, so every tile uploads on the first frame */
+  view->last = malloc(sizeof(*view->last) * tiles);
+  if (!view->last) {
+    SDL_DestroyTexture(view->atlas);
+    free(view);
+    return NULL;
+  }
+  memset(view->last, 0xFF, sizeof(*view->last) * tiles);
+
+  /* tiles past the last instance stay blank */
+  for (int tile = tiles; tile < view->columns * view->rows; tile++) {
+    SDL_Rect rect = {
+      (tile % view->columns) * SCREEN_WIDTH,
+      (tile / view->columns) * SCREEN_HEIGHT,
+      SCREEN_WIDTH,
+      SCREEN_HEIGHT
+    };
+    uint32_t pixels[SCREEN_HEIGHT][SCREEN_WIDTH] = {0};
+    SDL_UpdateTexture(view->atlas, &rect, pixels, sizeof(pixels[0]));
+  }
+
+  return view;
+}
+
+void mosaic_free(mosaic* view) {
+  SDL_DestroyTexture(view->atlas);
+  free(view->last);
+  free(view);
+}
@@ -0,0 +1,34 @@
+/*  @file   mosaic.h
+ *  @brief  Function prototypes and defines for multi-instance mosaic viewer
+ *  @author Ryan V. Ngo
+ */
+
+#ifndef MOSAIC_H
+#define MOSAIC_H
+
+#include <stdint.h>
+
+#include <SDL2/SDL_render.h>
+
+#include "rem8C.h"
+
+#define MOSAIC_MAX_TILES  1024
+
+typedef struct mosaic mosaic;
+
+/******************** Mosaic Operations ********************/
+
+void mosaic_update_tile(mosaic* view, int tile, uint8_t data[SCREEN_WIDTH][SCREEN_HEIGHT]);
+void mosaic_present(mosaic* view);
+
+/******************** Mosaic Configuration ********************/
+
+int mosaic_columns(mosaic* view);
+int mosaic_rows(mosaic* view);
+
+/******************** Mosaic Create/Destroy ********************/
+
+mosaic* mosaic_new(SDL_Renderer* renderer, int tiles);
+void mosaic_free(mosaic* view);
+
+#endif
@@ -3,29 +3,45 @@
  *  @author Ryan V. Ngo
  */
 
+#define _DEFAULT_SOURCE
+
 #include "rem8C.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <sys/mman.h>
 
 /******************** CHIP-8 & Internal ********************/
 
+/*  Registers touched on every cycle fit in the first cache line,
+ *  screen and memory each start on a line of their own.
+ */
 typedef struct rem8C {
-  uint8_t data_reg[16];
+  uint16_t pc;
   uint16_t I_register;
   uint16_t stack_pointer;
+  uint16_t sprite_addr;
+  uint8_t data_reg[16];
   uint8_t delay_timer;
   uint8_t sound_timer;
-  uint16_t pc;
-  uint16_t sprite_addr;
   uint8_t key_pressed;
   uint8_t key[16];
-  uint8_t screen[SCREEN_WIDTH][SCREEN_HEIGHT];
-  uint8_t memory[MAX_ADDR];
+  uint32_t rng_state;
+  uint8_t screen[SCREEN_WIDTH][SCREEN_HEIGHT] __attribute__((aligned(CACHE_LINE_SIZE)));
+  uint8_t memory[MAX_ADDR] __attribute__((aligned(CACHE_LINE_SIZE)));
   
 } rem8C;
 
+typedef struct rem8C_pool {
+  rem8C* instances;
+  size_t count;
+  size_t length;
+  rem8C template;
+} rem8C_pool;
+
+#define HUGE_PAGE_SIZE  (2 * 1024 * 1024)
+
 #define KEY_ON        0x1
 #define KEY_OFF       0x0
 
@@ -37,6 +53,13 @@ static const uint8_t key_binds[16] = {
 };
 
 #define FONT_SET_ADDR   0x0000
+
+/*  The stack grows down from here. 0x1FF is left free for
+ *  test ROMs that read a preset from it.
+ */
+#define STACK_ADDR      0x01FE
+
+#define RNG_SEED        0x2545F491
 #define SPRITE_WIDTH    5
 
 void _rem8C_push_pc_to_stack(rem8C* cpu) {
@@ -107,6 +130,18 @@ void _rem8C_screen_clear(rem8C* cpu) {
   memset(cpu->screen, 0x00, SCREEN_WIDTH * SCREEN_HEIGHT);
 }
 
+/*  xorshift32, kept in the struct so a snapshot also captures
+ *  the random sequence.
+ */
+uint8_t _rem8C_rand(rem8C* cpu) {
+  uint32_t x = cpu->rng_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  cpu->rng_state = x;
+  return x >> 24;
+}
+
 uint8_t _msb_reg_idx(uint8_t msb) {
   return msb & 0x0F;
 }
@@ -289,7 +324,7 @@ void _instr_BNNN(rem8C* cpu) {
 void _instr_CXNN(rem8C* cpu) {
   uint8_t X = _msb_reg_idx(cpu->memory[cpu->pc++]);
   uint8_t lsb = cpu->memory[cpu->pc++];
-  cpu->data_reg[X] = (rand() % 0xFF) & lsb;
+  cpu->data_reg[X] = _rem8C_rand(cpu) & lsb;
 }
 
 /* Draw sprite at (VX, VY) 8px wide and Npx tall */
@@ -547,14 +582,35 @@ void rem8C_memset(rem8C* cpu, uint16_t addr, void* data, size_t size) {
   memcpy(&cpu->memory[addr], data, size);
 }
 
+/* Seed the CXNN random sequence, xorshift can't use a seed of 0 */
+void rem8C_set_seed(rem8C* cpu, uint32_t seed) {
+  cpu->rng_state = seed ? seed : RNG_SEED;
+}
+
+/******************** CHIP-8 State ********************/
+
+/*  Copy the full machine state of src into dst.
+ *  The state is a flat struct, so a snapshot is a single memcpy.
+ */
+void rem8C_copy(rem8C* dst, const rem8C* src) {
+  memcpy(dst, src, sizeof(rem8C));
+}
+
 /******************** CHIP-8 Create/Destroy ********************/
 
-rem8C* rem8C_new() {
-  rem8C* cpu = malloc(sizeof(rem8C));
+void _rem8C_init(rem8C* cpu) {
+  memset(cpu, 0x00, sizeof(rem8C));
   cpu->pc = START_ADDR;
-  cpu->stack_pointer = START_ADDR - 0x01;
+  cpu->stack_pointer = STACK_ADDR;
   cpu->sprite_addr = FONT_SET_ADDR;
+  cpu->rng_state = RNG_SEED;
   _rem8C_sprite_set(cpu, cpu->sprite_addr);
+}
+
+rem8C* rem8C_new() {
+  rem8C* cpu = NULL;
+  if (posix_memalign((void**)&cpu, CACHE_LINE_SIZE, sizeof(rem8C)) != 0) return NULL;
+  _rem8C_init(cpu);
   return cpu;
 }
 
@@ -562,3 +618,74 @@ void rem8C_free(rem8C* cpu) {
   free(cpu);
 }
 
+/******************** CHIP-8 Pool ********************/
+
+/*  Map an anonymous arena, preferring explicit huge pages and falling back
+ *  to transparent huge pages. The mapping is page aligned, so every
+ *  instance in it is cache line aligned.
+ */
+void* _rem8C_arena_map(size_t length) {
+  void* arena = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  arena = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (arena == MAP_FAILED) {
+    arena = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+    madvise(arena, length, MADV_HUGEPAGE);
+#endif
+  }
+  return arena;
+}
+
+/*  Create count instances with the ROM in data loaded at load_addr.
+ *  Pool instances are owned by the pool and must not be passed to rem8C_free.
+ */
+rem8C_pool* rem8C_pool_new(size_t count, uint16_t load_addr, uint16_t start_addr, void* data, size_t size) {
+  if (count == 0) return NULL;
+
+  rem8C_pool* pool = NULL;
+  if (posix_memalign((void**)&pool, CACHE_LINE_SIZE, sizeof(rem8C_pool)) != 0) return NULL;
+
+  _rem8C_init(&pool->template);
+  rem8C_set_start_addr(&pool->template, start_addr);
+  if (data) rem8C_memset(&pool->template, load_addr, data, size);
+
+  pool->count = count;
+  pool->length = (count * sizeof(rem8C) + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  pool->instances = _rem8C_arena_map(pool->length);
+  if (!pool->instances) {
+    free(pool);
+    return NULL;
+  }
+
+  rem8C_pool_reset(pool);
+  return pool;
+}
+
+rem8C* rem8C_pool_get(rem8C_pool* pool, size_t idx) {
+  if (idx >= pool->count) return NULL;
+  return &pool->instances[idx];
+}
+
+size_t rem8C_pool_count(rem8C_pool* pool) {
+  return pool->count;
+}
+
+/*  Restore every instance to the template with one memcpy each.
+ *  Each instance gets its own seed so their random sequences differ,
+ *  instance 0 keeps the seed of rem8C_new.
+ */
+void rem8C_pool_reset(rem8C_pool* pool) {
+  for (size_t i = 0; i < pool->count; i++) {
+    memcpy(&pool->instances[i], &pool->template, sizeof(rem8C));
+    rem8C_set_seed(&pool->instances[i], RNG_SEED ^ (uint32_t)(i * 0x9E3779B9));
+  }
+}
+
+void rem8C_pool_free(rem8C_pool* pool) {
+  munmap(pool->instances, pool->length);
+  free(pool);
+}
+
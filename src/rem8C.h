@@ -15,7 +15,10 @@
 #define SCREEN_WIDTH  0x40
 #define SCREEN_HEIGHT 0x20
 
+#define CACHE_LINE_SIZE 64
+
 typedef struct rem8C rem8C;
+typedef struct rem8C_pool rem8C_pool;
 
 /******************** CHIP-8 Operations ********************/
 
@@ -29,10 +32,23 @@ void rem8C_unset_key(rem8C* cpu, uint8_t key);
 
 void rem8C_set_start_addr(rem8C* cpu, uint16_t addr);
 void rem8C_memset(rem8C* cpu, uint16_t addr, void* data, size_t size);
+void rem8C_set_seed(rem8C* cpu, uint32_t seed);
+
+/******************** CHIP-8 State ********************/
+
+void rem8C_copy(rem8C* dst, const rem8C* src);
 
 /******************** CHIP-8 Create/Destroy ********************/
 
 rem8C* rem8C_new();
 void rem8C_free(rem8C* cpu);
 
+/******************** CHIP-8 Pool ********************/
+
+rem8C_pool* rem8C_pool_new(size_t count, uint16_t load_addr, uint16_t start_addr, void* data, size_t size);
+rem8C* rem8C_pool_get(rem8C_pool* pool, size_t idx);
+size_t rem8C_pool_count(rem8C_pool* pool);
+void rem8C_pool_reset(rem8C_pool* pool);
+void rem8C_pool_free(rem8C_pool* pool);
+
 #endif
@@ -0,0 +1,448 @@
+/*  @file   harness.c
+ *  @brief  Headless conformance and performance harness for CHIP-8 emulator
+ *  @author Ryan V. Ngo
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "rem8C.h"
+
+#define LINE_MAX_LEN      256
+#define NAME_MAX_LEN      128
+#define PATH_MAX_LEN      512
+#define MAX_CASES         64
+
+/*  Cycles per timer update.
+ *  Mirrors the front end, which runs ~8 cycles per 60Hz timer tick.
+ */
+#define CYCLES_PER_TICK   8
+
+/*  Timendus test ROMs read this address to skip their selection menus. */
+#define SELECT_ADDR       0x01FF
+
+/*  A single run is microseconds long, so a measurement repeats the run
+ *  until BENCH_SECONDS have passed, and the best of BENCH_ROUNDS is kept.
+ */
+#define BENCH_SECONDS     0.1
+#define BENCH_ROUNDS      3
+
+/*  Allowed drop in instructions/sec relative to the host's baseline. */
+#define IPS_TOLERANCE     0.25
+
+#define POOL_CHECK_COUNT  64
+#define POOL_CHECK_CYCLES 500
+
+/*  Calls a subroutine that draws a sprite at a random position
+ *  and loops back, so every part of the state changes.
+ */
+static const uint8_t pool_check_rom[] = {
+  0x22, 0x04,   /* 200: call 204 */
+  0x12, 0x00,   /* 202: jump 200 */
+  0xA0, 0x00,   /* 204: I = 000 */
+  0xC0, 0x3F,   /* 206: V0 = rand & 3F */
+  0xC1, 0x1F,   /* 208: V1 = rand & 1F */
+  0xD0, 0x15,   /* 20A: draw 5 rows at (V0, V1) */
+  0x00, 0xEE,   /* 20C: return */
+};
+
+typedef struct {
+  char rom[NAME_MAX_LEN];
+  unsigned long cycles;
+  unsigned int select;
+  uint64_t hash;
+  int bench;
+} test_case;
+
+typedef struct {
+  char rom[NAME_MAX_LEN];
+  double ips;
+} bench_entry;
+
+typedef struct {
+  int passed;
+  int failed;
+} test_summary;
+
+int load_rom(const char* path, uint8_t** prog, long* size);
+int parse_case(const char* line, test_case* tc);
+uint64_t hash_screen(uint8_t data[SCREEN_WIDTH][SCREEN_HEIGHT]);
+void print_screen(uint8_t data[SCREEN_WIDTH][SCREEN_HEIGHT]);
+double monotonic_seconds();
+rem8C* prepare_case(test_case* tc, uint8_t* prog, long size);
+double run_cycles(rem8C* cpu, unsigned long cycles);
+double bench_case(test_case* tc, uint8_t* prog, long size);
+int load_baseline(const char* path, bench_entry* entries, int max);
+void save_baseline(const char* path, test_case* cases, double* ips, int count);
+int run_pool_check();
+int run_case(const char* rom_dir, test_case* tc, int update, bench_entry* baseline, int baseline_count, double* ips);
+
+int main(int argc, char* argv[]) {
+  /* argument parsing */
+  char* golden_file = "test/golden.txt";
+  char* out_file = NULL;
+  char* bench_file = NULL;
+  char* rom_dir = "roms";
+  int update = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "g:o:b:d:u")) != -1) {
+    switch (opt) {
+      case 'g':
+        golden_file = optarg;
+        break;
+      case 'o':
+        out_file = optarg;
+        break;
+      case 'b':
+        bench_file = optarg;
+        break;
+      case 'd':
+        rom_dir = optarg;
+        break;
+      case 'u':
+        update = 1;
+        break;
+      default: break;
+    }
+  }
+  if (!out_file) out_file = golden_file;
+
+  test_case cases[MAX_CASES];
+  char comments[LINE_MAX_LEN * 16] = {0};
+  int case_count = 0;
+  test_summary summary = {0};
+
+  FILE* golden = fopen(golden_file, "r");
+  if (!golden) {
+    printf("Golden file not found: %s\n", golden_file);
+    return 1;
+  }
+
+  char line[LINE_MAX_LEN];
+  while (fgets(line, sizeof(line), golden)) {
+    if (line[0] == '#' || line[0] == '\n') {
+      if (case_count == 0 && strlen(comments) + strlen(line) < sizeof(comments)) strcat(comments, line);
+      continue;
+    }
+    if (case_count == MAX_CASES || !parse_case(line, &cases[case_count])) {
+      printf("! Malformed golden entry: %s", line);
+      summary.failed++;
+      continue;
+    }
+    case_count++;
+  }
+  fclose(golden);
+
+  /*  The baseline is per host, so a missing file is recorded, not compared. */
+  bench_entry baseline[MAX_CASES];
+  int baseline_count = 0;
+  if (bench_file) baseline_count = load_baseline(bench_file, baseline, MAX_CASES);
+
+  /* running cases */
+  if (!update) {
+    if (run_pool_check()) summary.passed++;
+    else summary.failed++;
+  }
+
+  double ips[MAX_CASES] = {0};
+  for (int i = 0; i < case_count; i++) {
+    if (run_case(rom_dir, &cases[i], update, baseline, baseline_count, &ips[i])) summary.passed++;
+    else summary.failed++;
+  }
+
+  if (bench_file && !update && baseline_count < 0) {
+    if (summary.failed == 0) save_baseline(bench_file, cases, ips, case_count);
+    else printf("! Not recording baseline %s, %d cases failed !\n", bench_file, summary.failed);
+  }
+
+  /*  Written to a temporary file and renamed, so the output may be the golden file itself. */
+  if (update) {
+    if (summary.failed > 0) {
+      printf("! Not updating %s, %d cases failed !\n", out_file, summary.failed);
+      return 1;
+    }
+
+    char tmp_file[PATH_MAX_LEN];
+    snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", out_file);
+    FILE* out = fopen(tmp_file, "w");
+    if (!out) {
+      printf("! Failed to open %s !\n", tmp_file);
+      return 1;
+    }
+    fputs(comments, out);
+    for (int i = 0; i < case_count; i++) {
+      fprintf(out, "%s %lu %x %016llx %d\n", cases[i].rom, cases[i].cycles, cases[i].select,
+          (unsigned long long)cases[i].hash, cases[i].bench);
+    }
+    fclose(out);
+
+    if (rename(tmp_file, out_file) != 0) {
+      printf("! Failed to write %s !\n", out_file);
+      return 1;
+    }
+    printf("Updated %s\n", out_file);
+    return 0;
+  }
+
+  printf("\n%d passed, %d failed\n", summary.passed, summary.failed);
+  return summary.failed > 0;
+}
+
+int load_rom(const char* path, uint8_t** prog, long* size) {
+  FILE* rom = fopen(path, "rb");
+  if (!rom) return 0;
+
+  fseek(rom, 0, SEEK_END);
+  *size = ftell(rom);
+  rewind(rom);
+
+  if (*size <= 0 || *size > MAX_ADDR - START_ADDR) {
+    fclose(rom);
+    return 0;
+  }
+
+  *prog = malloc(sizeof(uint8_t) * (*size));
+  size_t objects_read = fread(*prog, sizeof(uint8_t), *size, rom);
+  fclose(rom);
+
+  if (objects_read < *size) {
+    free(*prog);
+    return 0;
+  }
+  return 1;
+}
+
+/*  Parse a golden entry of the form:
+ *    <rom> <cycles> <select> <hash> [<bench>]
+ *  A hash of 0 means no golden value has been recorded.
+ */
+int parse_case(const char* line, test_case* tc) {
+  unsigned long long hash;
+  tc->bench = 0;
+  int fields = sscanf(line, "%127s %lu %x %llx %d", tc->rom, &tc->cycles, &tc->select, &hash, &tc->bench);
+  if (fields < 4) return 0;
+  tc->hash = hash;
+  return 1;
+}
+
+/* FNV-1a over the screen buffer */
+uint64_t hash_screen(uint8_t data[SCREEN_WIDTH][SCREEN_HEIGHT]) {
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (int x = 0; x < SCREEN_WIDTH; x++) {
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+      hash ^= data[x][y];
+      hash *= 0x100000001B3ULL;
+    }
+  }
+  return hash;
+}
+
+/* Print the screen so a recorded hash can be checked by eye */
+void print_screen(uint8_t data[SCREEN_WIDTH][SCREEN_HEIGHT]) {
+  for (int y = 0; y < SCREEN_HEIGHT; y++) {
+    char row[SCREEN_WIDTH + 1] = {0};
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+      row[x] = data[x][y] ? '#' : '.';
+    }
+    printf("  %s\n", row);
+  }
+}
+
+double monotonic_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+rem8C* prepare_case(test_case* tc, uint8_t* prog, long size) {
+  rem8C* cpu = rem8C_new();
+  rem8C_set_start_addr(cpu, START_ADDR);
+  rem8C_memset(cpu, START_ADDR, prog, size);
+
+  if (tc->select) {
+    uint8_t select = tc->select;
+    rem8C_memset(cpu, SELECT_ADDR, &select, sizeof(select));
+  }
+  return cpu;
+}
+
+/* Run cycles on cpu, returning the elapsed time in seconds */
+double run_cycles(rem8C* cpu, unsigned long cycles) {
+  double start = monotonic_seconds();
+  for (unsigned long i = 0; i < cycles; i++) {
+    if (i % CYCLES_PER_TICK == 0) rem8C_update_timers(cpu);
+    rem8C_cycle(cpu);
+  }
+  return monotonic_seconds() - start;
+}
+
+/* Best instructions/sec over BENCH_ROUNDS rounds of at least BENCH_SECONDS each */
+double bench_case(test_case* tc, uint8_t* prog, long size) {
+  double best = 0;
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    double elapsed = 0;
+    unsigned long long cycles = 0;
+    while (elapsed < BENCH_SECONDS) {
+      rem8C* cpu = prepare_case(tc, prog, size);
+      elapsed += run_cycles(cpu, tc->cycles);
+      cycles += tc->cycles;
+      rem8C_free(cpu);
+    }
+    double ips = cycles / elapsed;
+    if (ips > best) best = ips;
+  }
+  return best;
+}
+
+/*  Load a per host baseline of the form:
+ *    <rom> <ips>
+ *  Returns the number of entries, or -1 if the file does not exist.
+ */
+int load_baseline(const char* path, bench_entry* entries, int max) {
+  FILE* file = fopen(path, "r");
+  if (!file) return -1;
+
+  int count = 0;
+  char line[LINE_MAX_LEN];
+  while (count < max && fgets(line, sizeof(line), file)) {
+    if (sscanf(line, "%127s %lf", entries[count].rom, &entries[count].ips) == 2) count++;
+  }
+  fclose(file);
+  return count;
+}
+
+void save_baseline(const char* path, test_case* cases, double* ips, int count) {
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    printf("! Failed to open %s !\n", path);
+    return;
+  }
+  for (int i = 0; i < count; i++) {
+    if (cases[i].bench) fprintf(file, "%s %.0f\n", cases[i].rom, ips[i]);
+  }
+  fclose(file);
+  printf("Recorded performance baseline: %s\n", path);
+}
+
+uint64_t run_and_hash(rem8C* cpu, unsigned long cycles) {
+  uint8_t screen_buff[SCREEN_WIDTH][SCREEN_HEIGHT] = {0};
+  run_cycles(cpu, cycles);
+  rem8C_read_screen(cpu, 0, 0, screen_buff, sizeof(screen_buff));
+  return hash_screen(screen_buff);
+}
+
+/*  Check that pool instances are aligned, that instance 0 starts from the
+ *  same state as rem8C_new, that instances are seeded apart, and that each
+ *  returns to its own start after rem8C_pool_reset. Returns 1 on pass.
+ */
+int run_pool_check() {
+  const char* error = NULL;
+
+  rem8C* fresh = rem8C_new();
+  rem8C_memset(fresh, START_ADDR, (void*)pool_check_rom, sizeof(pool_check_rom));
+  uint64_t blank = run_and_hash(fresh, 0);
+  uint64_t expected = run_and_hash(fresh, POOL_CHECK_CYCLES);
+  rem8C_free(fresh);
+
+  rem8C_pool* pool = rem8C_pool_new(POOL_CHECK_COUNT, START_ADDR, START_ADDR,
+      (void*)pool_check_rom, sizeof(pool_check_rom));
+
+  if (rem8C_pool_new(0, START_ADDR, START_ADDR, NULL, 0)) error = "empty pool created";
+  else if (!pool) error = "pool not created";
+  else if (rem8C_pool_count(pool) != POOL_CHECK_COUNT) error = "wrong count";
+  else if (rem8C_pool_get(pool, POOL_CHECK_COUNT)) error = "out of range instance returned";
+
+  uint64_t hashes[POOL_CHECK_COUNT] = {0};
+  for (size_t i = 0; !error && i < rem8C_pool_count(pool); i++) {
+    rem8C* cpu = rem8C_pool_get(pool, i);
+    hashes[i] = run_and_hash(cpu, POOL_CHECK_CYCLES);
+    if ((uintptr_t)cpu % CACHE_LINE_SIZE != 0) error = "instance not cache line aligned";
+  }
+  if (!error && hashes[0] != expected) error = "instance 0 differs from rem8C_new";
+  if (!error && hashes[1] == hashes[0]) error = "instances share a random sequence";
+
+  if (!error) rem8C_pool_reset(pool);
+
+  for (size_t i = 0; !error && i < rem8C_pool_count(pool); i++) {
+    rem8C* cpu = rem8C_pool_get(pool, i);
+    if (run_and_hash(cpu, 0) != blank) error = "screen not cleared by reset";
+    else if (run_and_hash(cpu, POOL_CHECK_CYCLES) != hashes[i]) error = "differs from its start after reset";
+  }
+
+  if (pool) rem8C_pool_free(pool);
+
+  if (error) printf("FAIL  %-24s %s\n", "pool", error);
+  else printf("PASS  %-24s %d instances\n", "pool", POOL_CHECK_COUNT);
+  return error == NULL;
+}
+
+/*  Run a single case, returning 1 on pass.
+ *  In update mode the measured hash is stored back into tc,
+ *  otherwise the measured instructions/sec of bench cases is stored in ips.
+ */
+int run_case(const char* rom_dir, test_case* tc, int update, bench_entry* baseline, int baseline_count, double* ips) {
+  char path[PATH_MAX_LEN];
+  snprintf(path, sizeof(path), "%s/%s", rom_dir, tc->rom);
+
+  uint8_t* prog = NULL;
+  long size = 0;
+  if (!load_rom(path, &prog, &size)) {
+    printf("FAIL  %-24s ROM not found in %s\n", tc->rom, rom_dir);
+    return 0;
+  }
+
+  /* conformance */
+  rem8C* cpu = prepare_case(tc, prog, size);
+  run_cycles(cpu, tc->cycles);
+
+  uint8_t screen_buff[SCREEN_WIDTH][SCREEN_HEIGHT] = {0};
+  rem8C_read_screen(cpu, 0, 0, screen_buff, sizeof(screen_buff));
+  rem8C_free(cpu);
+
+  uint64_t hash = hash_screen(screen_buff);
+
+  if (update) {
+    free(prog);
+    printf("%-30s hash %016llx\n", tc->rom, (unsigned long long)hash);
+    print_screen(screen_buff);
+    tc->hash = hash;
+    return 1;
+  }
+
+  /*  Only ROMs that keep executing their body are timed,
+   *  the others spend most of their cycles in a halt loop.
+   */
+  if (tc->bench) *ips = bench_case(tc, prog, size);
+  free(prog);
+
+  int ips_ok = 1;
+  char ips_note[64] = "";
+  for (int i = 0; tc->bench && i < baseline_count; i++) {
+    if (strcmp(baseline[i].rom, tc->rom) != 0) continue;
+    ips_ok = *ips >= baseline[i].ips * (1.0 - IPS_TOLERANCE);
+    snprintf(ips_note, sizeof(ips_note), " (%+.1f%%%s)",
+        (*ips / baseline[i].ips - 1.0) * 100.0, ips_ok ? "" : ", regression");
+  }
+
+  /* comparing results */
+  int hash_ok = (tc->hash != 0 && hash == tc->hash);
+
+  char ips_text[32] = "";
+  if (tc->bench) snprintf(ips_text, sizeof(ips_text), "  %.2f MIPS", *ips / 1e6);
+
+  printf("%s  %-24s hash %016llx%s%s%s\n",
+      (hash_ok && ips_ok) ? "PASS" : "FAIL",
+      tc->rom,
+      (unsigned long long)hash,
+      tc->hash == 0 ? " (no golden)" : (hash_ok ? "" : " (mismatch)"),
+      ips_text,
+      ips_note);
+
+  return hash_ok && ips_ok;
+}